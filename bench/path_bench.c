@@ -0,0 +1,72 @@
+// Microbenchmark of the path primitives against the scalar implementations they replaced.
+// Correctness is covered by tests/path_fuzz.c, this only checks that both agree on the benchmarked links.
+// usage: path_bench [iterations]
+
+#define _GNU_SOURCE
+
+#include "path.h"
+#include "path_reference.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#define COUNT 4096
+
+static char dirs[COUNT][256];
+static char values[COUNT][256];
+static char bufs[COUNT][512];
+static struct LinkPath links[COUNT];
+static bool results[COUNT];
+
+int main(int argc, char **argv) {
+	long iterations = argc > 1 ? atol(argv[1]) : 200;
+
+	// readlink results of a typical home directory: absolute links into the mine
+	const char *home = "/home/user/.config/nvim/lua/plugins";
+	const char *mine = "/home/user/dotmine";
+	for (int i = 0; i < COUNT; i++) {
+		snprintf(dirs[i], sizeof(dirs[i]), "%s/%i", home, i % 7);
+		snprintf(values[i], sizeof(values[i]), "%s/.config/nvim/lua/plugins/%i/file_%i.lua", i % 3 ? mine : "/usr/share", i % 7, i);
+		links[i] = (struct LinkPath){
+			.dir = dirs[i], .dir_len = strlen(dirs[i]),
+			.value = values[i], .value_len = strlen(values[i]),
+			.buf = bufs[i], .buf_len = sizeof(bufs[i])
+		};
+	}
+
+	size_t matched = 0;
+	double start = now();
+	for (long it = 0; it < iterations; it++) {
+		for (int i = 0; i < COUNT; i++) {
+			reference_normalize_path(links[i].dir, links[i].dir_len, links[i].value, links[i].value_len, bufs[i], sizeof(bufs[i]));
+			matched += reference_path_in(bufs[i], mine);
+		}
+	}
+	double reference = now() - start;
+
+	start = now();
+	for (long it = 0; it < iterations; it++) {
+		normalize_links(links, COUNT);
+		links_in(links, COUNT, mine, strlen(mine), results);
+		for (int i = 0; i < COUNT; i++) matched -= results[i];
+	}
+	double batch = now() - start;
+
+	if (matched != 0) {
+		fprintf(stderr, "batch results differ from the reference implementation\n");
+		return 1;
+	}
+
+	double ops = (double)iterations * COUNT;
+	printf("normalize + prefix (reference): %.1f ns/link\n", reference / ops * 1e9);
+	printf("normalize_links + links_in:     %.1f ns/link\n", batch / ops * 1e9);
+	return 0;
+}
@@ -93,8 +93,17 @@ void merge_directory(const char *path, const char *target) {
 
 		if (strcmp(link_path, target) == 0) { // remove symlink
 			ASSERT(remove(path) == 0, "error: remove failed with errno = %i", errno);
-		} else if (strstartswith(link_path, flags.mine)) { // broken target
-			TODO();
+		} else if (path_in(link_path, flags.mine, strlen(flags.mine))) { // wrong target
+			if (access(target, F_OK) == 0) { // the mine already has something here, and the directory gets symlinked to it
+				ASSERT(remove(path) == 0, "error: remove failed with errno = %i", errno);
+			} else {
+				printf("`%s` is a symlink to `%s`, elsewhere in the mine\n", path, link_path);
+				if (prompt_user("do you want to keep it (it will be a symlink inside of the mine)?", "yn", 'y') == 'y') {
+					handle_regular_file(path, target, false);
+				} else {
+					ASSERT(remove(path) == 0, "error: remove failed with errno = %i", errno);
+				}
+			}
 		} else {
 			handle_regular_file(path, target, false);
 		}
@@ -150,9 +159,14 @@ void add_path(const char *path, const char *target) {
 
 		if (strcmp(link_path, target) == 0) {
 			return; // nothing to do
-		} else if (strstartswith(link_path, flags.mine)) { // wrong target
-			// prompt user to fix
-			TODO();
+		} else if (path_in(link_path, flags.mine, strlen(flags.mine))) { // wrong target
+			printf("`%s` is a symlink to `%s` instead of `%s`\n", path, link_path, target);
+			if (access(target, F_OK) != 0) {
+				ERROR("error: `%s` does not exist (if the mine was moved or renamed, use `" NAME " relink`)", target);
+			}
+			if (prompt_user("do you want to relink it?", "yn", 'y') == 'y') {
+				ASSERT(replace_symlink(target, path) == 0, "error: relink failed with errno = %i", errno);
+			}
 		} else {
 			handle_regular_file(path, target, true);
 		}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <utils.h>
+#include <layers.h>
 
 #include <stdbool.h>
 
@@ -14,7 +15,13 @@ extern struct Flags {
 	bool help;
 	bool version;
 	bool recursive;
+	bool move;
+	/// number of threads used by parallel commands, 0 means one per processor
+	int jobs;
 	const char *mine;
+	/// `layers[0]` is the mine, every following layer shadows the previous ones
+	const char *layers[MAX_LAYERS];
+	int layer_count;
 } flags;
 
 /// May return NULL if there is no next argument
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+
+/// maximum number of stacked layers, base mine included
+#define MAX_LAYERS 16
+
+struct LayerEntry {
+	/// path relative to the layer roots (without leading `/`)
+	const char *path;
+	/// last component of `path`
+	const char *name;
+	/// 0 for entries directly inside of the layer roots
+	int depth;
+	/// index of the layer the entry is taken from (the highest one that has it)
+	int layer;
+	/// bit `i` is set if layer `i` has an entry at this path
+	unsigned present;
+	/// bit `i` is set if layer `i` contributes to the content of this directory.
+	/// always 0 for files.
+	unsigned merged;
+	bool is_dir;
+};
+
+enum LayerWalk {
+	WALK_CONTINUE,
+	/// don't descend into the current directory
+	WALK_SKIP
+};
+
+typedef enum LayerWalk (*LayerVisitor)(const struct LayerEntry *entry, void *data);
+
+/// Walks the effective tree of the given layers, where `roots[i]` shadows every layer below it.
+/// A file shadows everything below it, a directory gets merged with the directories directly below it.
+/// Entries are visited in sorted order (by `strcmp`), directories before their content.
+/// Every level is computed by a k-way merge of the sorted listings of each layer,
+/// so only one listing per layer and per level of depth is kept in memory.
+/// Panics if a root isn't a directory.
+void walk_layers(const char **roots, int count, LayerVisitor visit, void *data);
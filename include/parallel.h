@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stddef.h>
+
+typedef void (*ParallelTask)(size_t i, void *data);
+
+/// Calls `task(i, data)` for every `i` in [0, count) on `jobs` threads (the calling thread included).
+/// Indices are handed out one at a time, so tasks of uneven duration are balanced between threads.
+/// If `jobs` is 0 or less, uses the number of online processors.
+/// Panics if threads can't be created.
+void parallel_for(size_t count, int jobs, ParallelTask task, void *data);
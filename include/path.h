@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// Path primitives used on every entry of a traversal.
+/// Separators are searched with memchr/memrchr. Prefix comparisons are done 16 (SSE2) or 32 (AVX2)
+/// bytes at a time when the CPU supports it, with a scalar fallback (also used when built with -DNO_SIMD).
+
+/// returns a pointer to the first `/` in the `len` first bytes of `s`, or NULL if there isn't any
+const char *path_find_sep(const char *s, size_t len);
+/// returns a pointer to the last `/` in the `len` first bytes of `s`, or NULL if there isn't any
+const char *path_rfind_sep(const char *s, size_t len);
+/// returns the index of the first byte differing between `a` and `b`, or `len` if they're equal
+size_t path_mismatch(const char *a, const char *b, size_t len);
+
+/// returns true if the `s_len` bytes of `s` start with the `prefix_len` bytes of `prefix`
+bool path_startswith(const char *s, size_t s_len, const char *prefix, size_t prefix_len);
+
+/// takes a path and resolves every `..`, `.` and `/` in it, according to the given pwd.
+/// writes the result to `res`
+/// returns 0 on success and -1 if the given buffer wasn't big enough
+int normalize_path(const char *pwd, size_t pwd_len, const char * src, size_t src_len, char *buf, size_t buf_len);
+
+/// a symlink to normalize with `normalize_links`
+struct LinkPath {
+	/// directory containing the symlink
+	const char *dir;
+	size_t dir_len;
+	/// value of the symlink, as given by `readlink` (doesn't need to be null terminated)
+	const char *value;
+	size_t value_len;
+	/// buffer receiving the normalized path
+	char *buf;
+	size_t buf_len;
+	/// set by `normalize_links`: length of the normalized path, or -1 if `buf` wasn't big enough
+	long len;
+};
+
+/// normalizes every link in `links`, without allocating
+void normalize_links(struct LinkPath *links, size_t count);
+/// sets `results[i]` to true if the normalized path of `links[i]` is `dir` or is inside of it.
+/// links that failed to normalize are never inside.
+void links_in(const struct LinkPath *links, size_t count, const char *dir, size_t dir_len, bool *results);
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "utils.h"
+#include "flags.h"
+#include "parallel.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct Relink {
+	/// name of the symlink in its directory
+	char *name;
+	char *target;
+};
+
+/// consecutive symlinks of a single directory, relinked by the same worker
+struct RelinkChunk {
+	char *dir;
+	size_t first;
+	size_t count;
+};
+
+/// maximum number of symlinks in a chunk, so that big directories still get split between workers
+#define RELINK_CHUNK 256
+
+struct RelinkList {
+	struct Relink *items;
+	size_t len;
+	size_t cap;
+
+	struct RelinkChunk *chunks;
+	size_t chunks_len;
+	size_t chunks_cap;
+
+	const char *old_prefix;
+	size_t old_len;
+	const char *new_prefix;
+
+	atomic_size_t failed;
+};
+
+void collect_relink(const char *link, const char *link_path, void *data) {
+	struct RelinkList *list = data;
+
+	char target[PATH_MAX];
+	size_t n = snprintf(target, PATH_MAX, "%s%s", list->new_prefix, link_path + list->old_len);
+	ASSERT(n < PATH_MAX, "error: not enough space allocated for path");
+
+	const char *slash = strrchr(link, '/'); // `find_links` always gives paths inside of a directory
+	size_t dir_len = slash - link;
+
+	struct RelinkChunk *last = list->chunks_len > 0 ? &list->chunks[list->chunks_len-1] : NULL;
+	if (last == NULL || last->count == RELINK_CHUNK || strncmp(last->dir, link, dir_len) != 0 || last->dir[dir_len] != '\0') {
+		if (list->chunks_len == list->chunks_cap) {
+			list->chunks_cap = list->chunks_cap*2 + 16;
+			list->chunks = realloc(list->chunks, list->chunks_cap * sizeof(*list->chunks));
+			ASSERT(list->chunks != NULL, "error: realloc failed with errno = %i", errno);
+		}
+		list->chunks[list->chunks_len++] = (struct RelinkChunk){ .dir = strndup(link, dir_len), .first = list->len, .count = 0 };
+		last = &list->chunks[list->chunks_len-1];
+	}
+
+	if (list->len == list->cap) {
+		list->cap = list->cap*2 + 64;
+		list->items = realloc(list->items, list->cap * sizeof(*list->items));
+		ASSERT(list->items != NULL, "error: realloc failed with errno = %i", errno);
+	}
+	list->items[list->len++] = (struct Relink){ .name = strdup(slash + 1), .target = strdup(target) };
+	last->count++;
+}
+
+void relink_task(size_t i, void *data) {
+	struct RelinkList *list = data;
+	struct RelinkChunk *chunk = &list->chunks[i];
+
+	// resolve the directory once, every link is then replaced relative to it
+	int dir_fd = open(chunk->dir, O_PATH | O_DIRECTORY | O_CLOEXEC);
+	if (dir_fd == -1) {
+		LOG("error: could not open `%s`: errno = %i", chunk->dir, errno);
+		atomic_fetch_add(&list->failed, chunk->count);
+		return;
+	}
+
+	for (size_t j = chunk->first; j < chunk->first + chunk->count; j++) {
+		struct Relink *r = &list->items[j];
+
+		DLOG("log: relinking `%s/%s` to `%s`", chunk->dir, r->name, r->target);
+		if (replace_symlinkat(r->target, dir_fd, r->name) != 0) {
+			LOG("error: could not relink `%s/%s` to `%s`: errno = %i", chunk->dir, r->name, r->target, errno);
+			atomic_fetch_add(&list->failed, 1);
+		}
+	}
+
+	close(dir_fd);
+}
+
+/// Rewrites every symlink in the home directory pointing inside of `old_prefix` to point inside of `new_prefix` instead.
+/// Both prefixes should be normalized.
+/// Returns the number of relinked symlinks.
+size_t relink_home(const char *old_prefix, const char *new_prefix) {
+	struct RelinkList list = {
+		.old_prefix = old_prefix,
+		.old_len = strlen(old_prefix),
+		.new_prefix = new_prefix
+	};
+	atomic_init(&list.failed, 0);
+
+	find_links(flags.home, old_prefix, &old_prefix, 1, collect_relink, &list);
+
+	parallel_for(list.chunks_len, flags.jobs, relink_task, &list);
+
+	for (size_t i = 0; i < list.len; i++) {
+		free(list.items[i].name);
+		free(list.items[i].target);
+	}
+	free(list.items);
+	for (size_t i = 0; i < list.chunks_len; i++) {
+		free(list.chunks[i].dir);
+	}
+	free(list.chunks);
+
+	size_t failed = atomic_load(&list.failed);
+	ASSERT(failed == 0, "error: failed to relink %zu symlinks", failed);
+	return list.len;
+}
@@ -0,0 +1,374 @@
+#pragma once
+
+#include "utils.h"
+#include "flags.h"
+#include "parallel.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <linux/fs.h>
+
+struct CopyJob {
+	char *src;
+	char *dst;
+};
+
+struct RestoreJob {
+	/// symlink to be replaced
+	char *link;
+	/// what `link` points to in the mine
+	char *source;
+	/// copy of `source` next to `link`, NULL if `source` gets moved directly
+	char *tmp;
+	bool is_dir;
+};
+
+struct Restore {
+	struct RestoreJob *jobs;
+	size_t len;
+	size_t cap;
+
+	struct CopyJob *copies;
+	size_t copies_len;
+	size_t copies_cap;
+
+	/// copied directories, in post-order. They are created once everything is collected,
+	/// and their mode and times are applied once their content is copied
+	struct CopyJob *dirs;
+	size_t dirs_len;
+	size_t dirs_cap;
+
+	atomic_size_t failed;
+};
+
+/// Copies a regular file or a symlink, keeping its permissions and modification time.
+/// Regular files are reflinked when the filesystem supports it.
+/// Returns 0 on success and -1 on error, with errno set (EINVAL for any other kind of file)
+int copy_file(const char *src, const char *dst) {
+	struct stat sd = { 0 };
+	if (lstat(src, &sd) != 0) return -1;
+
+	if (S_ISLNK(sd.st_mode)) {
+		char link_value[PATH_MAX];
+		ssize_t n = readlink(src, link_value, PATH_MAX - 1);
+		if (n == -1) return -1;
+		link_value[n] = '\0';
+		return symlink(link_value, dst);
+	} else if (!S_ISREG(sd.st_mode)) { // opening a FIFO would block
+		errno = EINVAL;
+		return -1;
+	}
+
+	// O_NONBLOCK and the check below in case `src` got replaced since `lstat`
+	int in = open(src, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+	if (in == -1) return -1;
+	if (fstat(in, &sd) != 0 || !S_ISREG(sd.st_mode)) {
+		int stat_errno = S_ISREG(sd.st_mode) ? errno : EINVAL;
+		close(in);
+		errno = stat_errno;
+		return -1;
+	}
+	int out = open(dst, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, sd.st_mode & 07777);
+	if (out == -1) {
+		int open_errno = errno;
+		close(in);
+		errno = open_errno;
+		return -1;
+	}
+
+	int result = 0;
+	if (ioctl(out, FICLONE, in) != 0) { // no reflinks, copy the content
+		bool copied = false;
+		ssize_t n;
+		while ((n = copy_file_range(in, NULL, out, NULL, 1 << 30, 0)) > 0) copied = true;
+
+		if (n == -1 && !copied) { // copy_file_range isn't supported between those files
+			char buf[1 << 16];
+			while ((n = read(in, buf, sizeof(buf))) > 0) {
+				ssize_t written = 0;
+				while (written < n) {
+					ssize_t w = write(out, buf + written, n - written);
+					if (w == -1) break;
+					written += w;
+				}
+				if (written < n) {
+					n = -1;
+					break;
+				}
+			}
+		}
+		if (n == -1) result = -1;
+	}
+
+	const struct timespec times[2] = { sd.st_atim, sd.st_mtim };
+	if (result == 0 && (fchmod(out, sd.st_mode & 07777) != 0 || futimens(out, times) != 0)) result = -1;
+
+	int copy_errno = result == 0 ? 0 : errno;
+	close(in);
+	if (close(out) != 0 && result == 0) {
+		result = -1;
+		copy_errno = errno;
+	}
+	errno = copy_errno;
+	return result;
+}
+
+void push_copy(struct CopyJob **jobs, size_t *len, size_t *cap, const char *src, const char *dst) {
+	if (*len == *cap) {
+		*cap = *cap*2 + 64;
+		*jobs = realloc(*jobs, *cap * sizeof(**jobs));
+		ASSERT(*jobs != NULL, "error: realloc failed with errno = %i", errno);
+	}
+	(*jobs)[(*len)++] = (struct CopyJob){ .src = strdup(src), .dst = strdup(dst) };
+}
+
+/// Queues up the creation of every directory of `src` in `dst` and a copy job for everything else.
+/// Errors are counted in `r->failed`, nothing is created on disk yet.
+void copy_structure(struct Restore *r, const char *src, const char *dst) {
+	DIR *dp = opendir(src);
+	if (dp == NULL) {
+		LOG("error: could not open `%s`: errno = %i", src, errno);
+		atomic_fetch_add(&r->failed, 1);
+		return;
+	}
+
+	errno = 0;
+	struct dirent *ep;
+	while ((ep = readdir(dp)) != NULL) {
+		if (strcmp(ep->d_name, ".") == 0 || strcmp(ep->d_name, "..") == 0) { // avoid self recursion
+			continue;
+		}
+
+		char new_src[PATH_MAX];
+		char new_dst[PATH_MAX];
+		if ((size_t)snprintf(new_src, PATH_MAX, "%s/%s", src, ep->d_name) >= PATH_MAX
+				|| (size_t)snprintf(new_dst, PATH_MAX, "%s/%s", dst, ep->d_name) >= PATH_MAX) {
+			LOG("error: path `%s/%s` is too long", src, ep->d_name);
+			atomic_fetch_add(&r->failed, 1);
+			errno = 0;
+			continue;
+		}
+
+		bool is_dir = ep->d_type == DT_DIR;
+		if (ep->d_type == DT_UNKNOWN) { // filesystem doesn't fill d_type
+			struct stat child_sd = { 0 };
+			if (lstat(new_src, &child_sd) != 0) {
+				LOG("error: could not stat `%s`: errno = %i", new_src, errno);
+				atomic_fetch_add(&r->failed, 1);
+				errno = 0;
+				continue;
+			}
+			is_dir = S_ISDIR(child_sd.st_mode);
+		}
+
+		if (is_dir) copy_structure(r, new_src, new_dst);
+		else push_copy(&r->copies, &r->copies_len, &r->copies_cap, new_src, new_dst);
+		errno = 0;
+	}
+	if (errno != 0) {
+		LOG("error: could not read `%s`: errno = %i", src, errno);
+		atomic_fetch_add(&r->failed, 1);
+	}
+	closedir(dp);
+
+	push_copy(&r->dirs, &r->dirs_len, &r->dirs_cap, src, dst);
+}
+
+/// queues up the replacement of `link` by `source`
+void add_restore(struct Restore *r, const char *link, const char *source) {
+	struct stat source_sd = { 0 };
+	if (lstat(source, &source_sd) != 0) {
+		LOG("warning: `%s` points to `%s`, which doesn't exist, skipping", link, source);
+		return;
+	}
+
+	if (r->len == r->cap) {
+		r->cap = r->cap*2 + 64;
+		r->jobs = realloc(r->jobs, r->cap * sizeof(*r->jobs));
+		ASSERT(r->jobs != NULL, "error: realloc failed with errno = %i", errno);
+	}
+	struct RestoreJob *job = &r->jobs[r->len++];
+	*job = (struct RestoreJob){ .link = strdup(link), .source = strdup(source), .tmp = NULL, .is_dir = S_ISDIR(source_sd.st_mode) };
+
+	const char *slash = strrchr(link, '/');
+	int dir_len = slash == NULL ? 0 : slash - link + 1;
+
+	if (flags.move) {
+		char dir[PATH_MAX] = ".";
+		if (dir_len > 0) snprintf(dir, PATH_MAX, "%.*s", dir_len, link);
+
+		struct stat dir_sd = { 0 };
+		if (stat(dir, &dir_sd) != 0) {
+			LOG("error: could not stat `%s`: errno = %i", dir, errno);
+			atomic_fetch_add(&r->failed, 1);
+			return;
+		}
+		if (dir_sd.st_dev == source_sd.st_dev) return; // same filesystem, `source` can be moved directly
+	}
+
+	// fixed length, so that links with long names don't end up with a temporary name over NAME_MAX
+	char tmp[PATH_MAX];
+	size_t n = snprintf(tmp, PATH_MAX, "%.*s." NAME "-restore-%i-%zu", dir_len, link, getpid(), r->len - 1);
+	if (n >= PATH_MAX) {
+		LOG("error: path `%s` is too long", link);
+		atomic_fetch_add(&r->failed, 1);
+		return;
+	}
+	job->tmp = strdup(tmp);
+
+	if (job->is_dir) copy_structure(r, source, tmp);
+	else push_copy(&r->copies, &r->copies_len, &r->copies_cap, source, tmp);
+}
+
+void collect_restore(const char *link, const char *link_path, void *data) {
+	add_restore(data, link, link_path);
+}
+
+void copy_task(size_t i, void *data) {
+	struct Restore *r = data;
+	struct CopyJob *c = &r->copies[i];
+
+	if (copy_file(c->src, c->dst) != 0) {
+		if (errno == EINVAL) LOG("error: could not copy `%s`: not a regular file or a symlink", c->src);
+		else LOG("error: could not copy `%s` to `%s`: errno = %i", c->src, c->dst, errno);
+		atomic_fetch_add(&r->failed, 1);
+	}
+}
+
+/// copies the mode and times of a directory, which doesn't change the times of its parent
+void dir_attributes_task(size_t i, void *data) {
+	struct Restore *r = data;
+	struct CopyJob *d = &r->dirs[i];
+
+	struct stat sd = { 0 };
+	if (lstat(d->src, &sd) != 0) {
+		LOG("error: could not stat `%s`: errno = %i", d->src, errno);
+		atomic_fetch_add(&r->failed, 1);
+		return;
+	}
+
+	const struct timespec times[2] = { sd.st_atim, sd.st_mtim };
+	if (chmod(d->dst, sd.st_mode & 07777) != 0 || utimensat(AT_FDCWD, d->dst, times, AT_SYMLINK_NOFOLLOW) != 0) {
+		LOG("error: could not copy the attributes of `%s` to `%s`: errno = %i", d->src, d->dst, errno);
+		atomic_fetch_add(&r->failed, 1);
+	}
+}
+
+void restore_task(size_t i, void *data) {
+	struct Restore *r = data;
+	struct RestoreJob *job = &r->jobs[i];
+	const char *from = job->tmp != NULL ? job->tmp : job->source;
+
+	// `rename` can't replace a symlink by a directory, so directories are swapped with the symlink,
+	// which gets removed afterwards
+	DLOG("log: replacing `%s` by `%s`", job->link, from);
+	if (!job->is_dir) {
+		if (rename(from, job->link) != 0) {
+			LOG("error: could not replace `%s` by `%s`: errno = %i", job->link, from, errno);
+			atomic_fetch_add(&r->failed, 1);
+			return;
+		}
+	} else if (renameat2(AT_FDCWD, from, AT_FDCWD, job->link, RENAME_EXCHANGE) != 0) {
+		LOG("error: could not replace `%s` by `%s`: errno = %i", job->link, from, errno);
+		atomic_fetch_add(&r->failed, 1);
+		return;
+	} else if (unlink(from) != 0) {
+		LOG("error: could not remove `%s`: errno = %i", from, errno);
+		atomic_fetch_add(&r->failed, 1);
+		return;
+	}
+
+	if (flags.move && job->tmp != NULL) {
+		remove_recursive(job->source); // was copied to another filesystem
+	}
+}
+
+/// Replaces every symlink to the mine (or its layers) at or under `path` by a copy of what it points to.
+/// With `flags.move`, the content is moved out of the mine instead.
+/// Everything is copied before the first symlink is replaced, and each one is swapped atomically.
+/// Returns the number of restored symlinks.
+size_t restore_path(const char *path) {
+	struct Restore r = { 0 };
+	atomic_init(&r.failed, 0);
+
+	char link[PATH_MAX];
+	int n = snprintf(link, PATH_MAX, "%s", path);
+	ASSERT(n < PATH_MAX, "error: not enough space allocated for path");
+	while (n > 1 && link[n-1] == '/') link[--n] = '\0'; // don't follow the symlink
+
+	struct stat sd = { 0 };
+	if (lstat(link, &sd) != 0) {
+		if (errno == ENOENT) ERROR("error: given path `%s` does not exist", path);
+		else ERROR("error: stat failed with errno = %i", errno);
+	}
+
+	if (S_ISLNK(sd.st_mode)) {
+		char link_path[1024];
+		get_link_path(link, link_path, 1024);
+		if (!in_layers(link_path)) ERROR("error: `%s` doesn't point inside of the mine", path);
+
+		add_restore(&r, link, link_path);
+	} else if (S_ISDIR(sd.st_mode)) {
+		find_links(link, NULL, flags.layers, flags.layer_count, collect_restore, &r);
+	} else {
+		ERROR("error: `%s` isn't a symlink or a directory", path);
+	}
+
+	// parents before their content, writable until it is copied (the real mode is applied by `dir_attributes_task`)
+	for (size_t i = r.dirs_len; i > 0 && atomic_load(&r.failed) == 0; i--) {
+		if (mkdir(r.dirs[i-1].dst, S_IRWXU) != 0) {
+			LOG("error: could not create `%s`: errno = %i", r.dirs[i-1].dst, errno);
+			atomic_fetch_add(&r.failed, 1);
+		}
+	}
+	if (atomic_load(&r.failed) == 0) {
+		parallel_for(r.copies_len, flags.jobs, copy_task, &r);
+	}
+	if (atomic_load(&r.failed) == 0) {
+		parallel_for(r.dirs_len, flags.jobs, dir_attributes_task, &r);
+	}
+
+	if (atomic_load(&r.failed) == 0) {
+		parallel_for(r.len, flags.jobs, restore_task, &r);
+	} else { // don't touch any symlink if anything is missing
+		for (size_t i = 0; i < r.len; i++) {
+			if (r.jobs[i].tmp == NULL) continue;
+
+			struct stat tmp_sd = { 0 };
+			if (lstat(r.jobs[i].tmp, &tmp_sd) == 0) remove_recursive(r.jobs[i].tmp);
+			else if (errno != ENOENT) LOG("warning: could not remove `%s`: errno = %i", r.jobs[i].tmp, errno);
+			// else: the copy failed before creating it
+		}
+		ERROR("error: %zu files could not be copied, no symlink was replaced", atomic_load(&r.failed));
+	}
+
+	for (size_t i = 0; i < r.copies_len; i++) {
+		free(r.copies[i].src);
+		free(r.copies[i].dst);
+	}
+	free(r.copies);
+	for (size_t i = 0; i < r.dirs_len; i++) {
+		free(r.dirs[i].src);
+		free(r.dirs[i].dst);
+	}
+	free(r.dirs);
+	for (size_t i = 0; i < r.len; i++) {
+		free(r.jobs[i].link);
+		free(r.jobs[i].source);
+		free(r.jobs[i].tmp);
+	}
+	free(r.jobs);
+
+	size_t failed = atomic_load(&r.failed);
+	ASSERT(failed == 0, "error: failed to restore %zu files", failed);
+	return r.len;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "utils.h"
+#include "flags.h"
+#include "layers.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// `LayerVisitor` symlinking every entry of the effective tree in the home directory.
+/// Directories coming from a single layer get symlinked as a whole (unless --recursive is given),
+/// merged directories are created in the home directory and traversed.
+enum LayerWalk stow_entry(const struct LayerEntry *entry, void *data) {
+	(void)data;
+
+	char home_path[1024];
+	const char *separator = flags.home[strlen(flags.home)-1] == '/' ? "" : "/";
+	size_t n = snprintf(home_path, 1024, "%s%s%s", flags.home, separator, entry->path);
+	ASSERT(n <= 1023, "error: not enough space allocated for path");
+
+	char mine_path[1024];
+	const char *layer = flags.layers[entry->layer];
+	separator = layer[strlen(layer)-1] == '/' ? "" : "/";
+	n = snprintf(mine_path, 1024, "%s%s%s", layer, separator, entry->path);
+	ASSERT(n <= 1023, "error: not enough space allocated for path");
+
+	bool fold = !entry->is_dir || (!flags.recursive && __builtin_popcount(entry->merged) == 1);
+
+	struct stat sd = { 0 };
+	if (lstat(home_path, &sd) != 0) {
+		if (errno != ENOENT) ERROR("error: stat failed with errno = %i", errno);
+
+		if (fold) {
+			DLOG("log: creating symlink `%s` to `%s`", home_path, mine_path);
+			create_symlink(mine_path, home_path);
+			return WALK_SKIP;
+		}
+		create_directory(home_path);
+		return WALK_CONTINUE;
+	}
+
+	if (S_ISLNK(sd.st_mode)) {
+		char link_path[1024];
+		get_link_path(home_path, link_path, 1024);
+
+		if (fold && strcmp(link_path, mine_path) == 0) {
+			return WALK_SKIP; // already stowed
+		} else if (!in_layers(link_path)) {
+			printf("`%s` is a symlink to `%s`, which isn't managed by " NAME ", skipping\n", home_path, link_path);
+			return WALK_SKIP;
+		}
+
+		// points to a shadowed layer, or to a directory that is now merged from multiple layers
+		DLOG("log: replacing stale symlink `%s` to `%s`", home_path, link_path);
+		ASSERT(remove(home_path) == 0, "error: remove failed with errno = %i", errno);
+		if (fold) {
+			create_symlink(mine_path, home_path);
+			return WALK_SKIP;
+		}
+		create_directory(home_path);
+		return WALK_CONTINUE;
+	}
+
+	if (S_ISDIR(sd.st_mode) && entry->is_dir) {
+		return WALK_CONTINUE; // symlink the content inside of the existing directory
+	}
+
+	printf("a file already exists at `%s`, skipping (use `" NAME " add` to put it in the mine)\n", home_path);
+	return WALK_SKIP;
+}
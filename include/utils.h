@@ -3,6 +3,8 @@
 #include <stdio.h>
 #include <stdbool.h>
 
+#include "path.h"
+
 #define LOG(format, ...) do { \
 		fprintf(stderr, "%s:%i: ", __FILE_NAME__, __LINE__); \
 		fprintf(stderr, format,##__VA_ARGS__); \
@@ -35,6 +37,10 @@
 
 
 bool strstartswith(const char *s, const char *prefix);
+/// returns true if `path` is `dir` or is inside of it
+bool path_in(const char *path, const char *dir, size_t dir_len);
+/// returns true if `path` is inside of the mine or one of its layers
+bool in_layers(const char *path);
 void get_link_path(const char *link, char *buf, ssize_t bufsize);
 
 /// returns the given path in mine directory
@@ -44,6 +50,12 @@ char *get_target_path(const char *path);
 /// removes trailing `/`s from `link_name`
 /// panics on any other `symlink` error
 void create_symlink(const char *target, const char *link_name);
+/// atomically replaces whatever is at `name` in the directory `dir_fd` with a symlink to `target`,
+/// by creating it under a short temporary name in the same directory and renaming it over.
+/// returns 0 on success and -1 on error, with errno set
+int replace_symlinkat(const char *target, int dir_fd, const char *name);
+/// same as `replace_symlinkat`, in the directory of `link_name` (which shouldn't have trailing `/`s)
+int replace_symlink(const char *target, const char *link_name);
 
 /// Prompts the user with the given choices and returns which index was chosen.
 /// Choices is a list of possible one character string the user can enter.
@@ -65,7 +77,10 @@ void create_directory(const char *path);
 /// Takes a char *, as it modifies its input, but every modification is reversed by the end of the function
 void create_structure(char *path);
 
-/// takes a path and resolves every `..`, `.` and `/` in it, according to the given pwd.
-/// writes the result to `res`
-/// returns 0 on success and -1 if the given buffer wasn't big enough
-int normalize_path(const char *pwd, size_t pwd_len, const char * src, size_t src_len, char *buf, size_t buf_len);
+/// called with the path of a symlink and the normalized path it points to
+typedef void (*LinkVisitor)(const char *link, const char *link_path, void *data);
+/// Calls `visit` on every symlink under the directory `dir` pointing inside of one of the `target_count` `targets`
+/// (at most MAX_LAYERS). The symlinks of a directory are normalized and compared in batches.
+/// Doesn't follow symlinks, and doesn't go inside of the layers or inside of `skip` (which can be NULL).
+/// Unreadable directories and paths longer than PATH_MAX are skipped with a warning.
+void find_links(const char *dir, const char *skip, const char *const *targets, int target_count, LinkVisitor visit, void *data);
@@ -1,7 +1,10 @@
 #include "flags.h"
 
+#include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 struct Flags flags;
 
@@ -24,6 +27,14 @@ const char *get_next(const char *name) {
 	return next;
 }
 
+/// writes `path` to the 1024 bytes of `buf`, normalized and relative to the working directory
+static void absolute_path(const char *path, char *buf) {
+	char pwd[1024];
+	ASSERT(getcwd(pwd, 1024) != NULL, "error: getcwd failed with errno = %i", errno);
+	int result = normalize_path(pwd, strlen(pwd), path, strlen(path), buf, 1024);
+	ASSERT(result == 0, "error: not enough space for path");
+}
+
 void init_flags(int argc, char **argv, const char *default_dir) {
 	flags.i = 0;
 	flags.argc = argc;
@@ -32,11 +43,14 @@ void init_flags(int argc, char **argv, const char *default_dir) {
 
 	flags.help = false;
 	flags.recursive = false;
+	flags.move = false;
+	flags.jobs = 0;
 
 	static char buf[1024];
 	int n = snprintf(buf, 1024, "%s/%s", flags.home, default_dir);
 	ASSERT(n <= 1023, "error: not enough space for path");
 	flags.mine = buf;
+	flags.layer_count = 1;
 }
 
 const char *parse_args() {
@@ -56,11 +70,39 @@ const char *parse_args() {
 				flags.version = true;
 			} else if (strcmp(*curr, "--recursive") == 0 || strcmp(*curr, "-r") == 0) {
 				flags.recursive = true;
+			} else if (strcmp(*curr, "--move") == 0 || strcmp(*curr, "-m") == 0) {
+				flags.move = true;
 			} else if (strcmp(*curr, "--mine") == 0) {
 				*curr = NULL;
 				curr = &flags.argv[++flags.i];
 				if (flags.i >= flags.argc) ERROR("error: no value given to option --mine");
-				flags.mine = *curr;
+
+				// the mine is symlinked to like the other layers, so it needs to be absolute
+				static char mine_buf[1024];
+				absolute_path(*curr, mine_buf);
+				flags.mine = mine_buf;
+			} else if (strcmp(*curr, "--jobs") == 0 || strcmp(*curr, "-j") == 0) {
+				*curr = NULL;
+				curr = &flags.argv[++flags.i];
+				if (flags.i >= flags.argc) ERROR("error: no value given to option --jobs");
+				char *end;
+				errno = 0;
+				long jobs = strtol(*curr, &end, 10);
+				if (end == *curr || *end != '\0' || errno != 0 || jobs < 0 || jobs > INT_MAX) {
+					ERROR("error: invalid number of jobs `%s`", *curr);
+				}
+				flags.jobs = jobs;
+			} else if (strcmp(*curr, "--layer") == 0 || strcmp(*curr, "-l") == 0) {
+				*curr = NULL;
+				curr = &flags.argv[++flags.i];
+				if (flags.i >= flags.argc) ERROR("error: no value given to option --layer");
+				if (flags.layer_count >= MAX_LAYERS) ERROR("error: too many layers (maximum is %i)", MAX_LAYERS);
+
+				// layers are symlinked to, so they need to be absolute
+				static char layer_bufs[MAX_LAYERS][1024];
+				absolute_path(*curr, layer_bufs[flags.layer_count]);
+				flags.layers[flags.layer_count] = layer_bufs[flags.layer_count];
+				flags.layer_count++;
 			} else {
 				ERROR("error: unknown option %s", *curr);
 			}
@@ -69,6 +111,8 @@ const char *parse_args() {
 		}
 	}
 
+	flags.layers[0] = flags.mine;
+
 	flags.i = 1;
 	return get_some_next();
 }
@@ -0,0 +1,180 @@
+#define _GNU_SOURCE
+
+#include "layers.h"
+#include "utils.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct ListingEntry {
+	/// offset of the name in `Listing.names`
+	size_t name;
+	bool is_dir;
+};
+
+/// sorted content of a single directory of a layer
+struct Listing {
+	DIR *dp; // kept open for `openat` on subdirectories
+	struct ListingEntry *entries;
+	size_t len;
+	size_t cap;
+	char *names;
+	size_t names_len;
+	size_t names_cap;
+	size_t head; // next entry to be merged
+};
+
+/// `names` is the `Listing.names` buffer the entries point into
+static int compare_entries(const void *a, const void *b, void *names) {
+	const struct ListingEntry *ea = a, *eb = b;
+	return strcmp((const char *)names + ea->name, (const char *)names + eb->name);
+}
+
+/// takes ownership of `fd`
+static void read_listing(int fd, struct Listing *l) {
+	*l = (struct Listing){ 0 };
+	l->dp = fdopendir(fd);
+	ASSERT(l->dp != NULL, "error: fdopendir failed with errno = %i", errno);
+
+	errno = 0;
+	struct dirent *ep;
+	while ((ep = readdir(l->dp)) != NULL) {
+		if (strcmp(ep->d_name, ".") == 0 || strcmp(ep->d_name, "..") == 0) { // avoid self recursion
+			continue;
+		}
+
+		bool is_dir = ep->d_type == DT_DIR;
+		if (ep->d_type == DT_UNKNOWN) { // filesystem doesn't fill d_type
+			struct stat sd = { 0 };
+			ASSERT(fstatat(fd, ep->d_name, &sd, AT_SYMLINK_NOFOLLOW) == 0, "error: stat failed with errno = %i", errno);
+			is_dir = S_ISDIR(sd.st_mode);
+		}
+
+		size_t name_len = strlen(ep->d_name) + 1;
+		if (l->names_len + name_len > l->names_cap) {
+			l->names_cap = l->names_cap*2 + name_len + 256;
+			l->names = realloc(l->names, l->names_cap);
+			ASSERT(l->names != NULL, "error: realloc failed with errno = %i", errno);
+		}
+		if (l->len == l->cap) {
+			l->cap = l->cap*2 + 16;
+			l->entries = realloc(l->entries, l->cap * sizeof(*l->entries));
+			ASSERT(l->entries != NULL, "error: realloc failed with errno = %i", errno);
+		}
+
+		memcpy(l->names + l->names_len, ep->d_name, name_len);
+		l->entries[l->len++] = (struct ListingEntry){ .name = l->names_len, .is_dir = is_dir };
+		l->names_len += name_len;
+		errno = 0;
+	}
+	ASSERT(errno == 0, "error: readdir failed with errno = %i", errno);
+
+	qsort_r(l->entries, l->len, sizeof(*l->entries), compare_entries, l->names);
+}
+
+static void free_listing(struct Listing *l) {
+	ASSERT(closedir(l->dp) == 0, "error: closedir failed with errno = %i", errno);
+	free(l->entries);
+	free(l->names);
+}
+
+static inline const char *head_name(const struct Listing *l) {
+	return l->names + l->entries[l->head].name;
+}
+
+/// `fds[i]` is an open directory for every layer set in `mask`, and is consumed by this function
+/// `path` is a buffer of 1024 bytes holding the current relative path
+static void walk_level(int *fds, unsigned mask, int count, char *path, size_t path_len, int depth, LayerVisitor visit, void *data) {
+	struct Listing listings[MAX_LAYERS];
+	for (int i = 0; i < count; i++) {
+		if (mask & (1u << i)) read_listing(fds[i], &listings[i]);
+	}
+
+	while (true) {
+		// smallest name among the heads of every listing
+		const char *min = NULL;
+		for (int i = 0; i < count; i++) {
+			if (!(mask & (1u << i)) || listings[i].head == listings[i].len) continue;
+
+			const char *name = head_name(&listings[i]);
+			if (min == NULL || strcmp(name, min) < 0) min = name;
+		}
+		if (min == NULL) break; // every listing is exhausted
+
+		unsigned present = 0, dirs = 0;
+		int top = 0;
+		for (int i = 0; i < count; i++) {
+			if (!(mask & (1u << i)) || listings[i].head == listings[i].len) continue;
+
+			const struct ListingEntry *e = &listings[i].entries[listings[i].head];
+			if (strcmp(listings[i].names + e->name, min) != 0) continue;
+
+			present |= 1u << i;
+			if (e->is_dir) dirs |= 1u << i;
+			top = i;
+		}
+
+		// merge directories downwards until something that isn't a directory shadows the rest
+		unsigned merged = 0;
+		for (int i = top; i >= 0; i--) {
+			if (!(present & (1u << i))) continue;
+			if (!(dirs & (1u << i))) break;
+			merged |= 1u << i;
+		}
+
+		const char *separator = path_len == 0 ? "" : "/";
+		size_t n = snprintf(path + path_len, 1024 - path_len, "%s%s", separator, min);
+		ASSERT(path_len + n <= 1023, "error: not enough space allocated for path");
+
+		struct LayerEntry entry = {
+			.path = path,
+			.name = path + path_len + strlen(separator),
+			.depth = depth,
+			.layer = top,
+			.present = present,
+			.merged = merged,
+			.is_dir = merged != 0
+		};
+
+		if (visit(&entry, data) == WALK_CONTINUE && entry.is_dir) {
+			int child_fds[MAX_LAYERS];
+			for (int i = 0; i < count; i++) {
+				if (!(merged & (1u << i))) continue;
+
+				child_fds[i] = openat(dirfd(listings[i].dp), min, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+				ASSERT(child_fds[i] != -1, "error: open failed with errno = %i", errno);
+			}
+			walk_level(child_fds, merged, count, path, path_len + n, depth + 1, visit, data);
+		}
+		path[path_len] = '\0';
+
+		for (int i = 0; i < count; i++) {
+			if (present & (1u << i)) listings[i].head++;
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (mask & (1u << i)) free_listing(&listings[i]);
+	}
+}
+
+void walk_layers(const char **roots, int count, LayerVisitor visit, void *data) {
+	ASSERT(count > 0 && count <= MAX_LAYERS, "error: invalid number of layers: %i", count);
+
+	int fds[MAX_LAYERS];
+	for (int i = 0; i < count; i++) {
+		fds[i] = open(roots[i], O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (fds[i] == -1) {
+			if (errno == ENOENT) ERROR("error: layer `%s` does not exist", roots[i]);
+			else ERROR("error: open failed with errno = %i", errno);
+		}
+	}
+
+	char path[1024] = { 0 };
+	walk_level(fds, (1u << count) - 1, count, path, 0, 0, visit, data);
+}
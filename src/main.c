@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+
 #include <ctype.h>
 #include <errno.h>
 #include <stdint.h>
@@ -16,6 +18,10 @@
 #include "flags.h"
 
 #include "add.h"
+#include "layers.h"
+#include "stow.h"
+#include "relink.h"
+#include "restore.h"
 
 // TODO: (PROJECT WIDE) Dynamic memory allocation for computed paths
 
@@ -49,11 +55,83 @@ void command_add() {
 	printf("success!\n");
 }
 
+void command_stow() {
+	if (flags.help) {
+		printf("usage: " NAME " [--mine MINE] [-l|--layer LAYER]... [-r|--recursive] stow\n\n");
+		printf("Symlinks every file of the mine (and its layers) in the home directory\n");
+		return;
+	}
+
+	walk_layers(flags.layers, flags.layer_count, stow_entry, NULL);
+
+	printf("success!\n");
+}
+
+void command_relink() {
+	if (flags.help) {
+		printf("usage: " NAME " [--mine MINE] [-l|--layer LAYER]... [-j|--jobs N] relink <old> [new]\n\n");
+		printf("Rewrites every symlink in the home directory pointing inside of <old> to point inside of <new> (default: the mine)\n");
+		return;
+	}
+
+	const char *old_arg = get_next("old");
+	const char *new_arg = get_some_next();
+	if (new_arg == NULL) new_arg = flags.mine;
+
+	char pwd[1024];
+	ASSERT(getcwd(pwd, 1024) != NULL, "error: getcwd failed with errno = %i", errno);
+
+	char old_prefix[1024];
+	int result = normalize_path(pwd, strlen(pwd), old_arg, strlen(old_arg), old_prefix, 1024);
+	ASSERT(result == 0, "error: not enough space for path");
+
+	char new_prefix[1024];
+	result = normalize_path(pwd, strlen(pwd), new_arg, strlen(new_arg), new_prefix, 1024);
+	ASSERT(result == 0, "error: not enough space for path");
+
+	if (access(new_prefix, F_OK) != 0) {
+		ERROR("error: `%s` doesn't exist", new_prefix);
+	}
+
+	size_t n = relink_home(old_prefix, new_prefix);
+	printf("relinked %zu symlinks from `%s` to `%s`\n", n, old_prefix, new_prefix);
+}
+
+void command_restore() {
+	if (flags.help) {
+		printf("usage: " NAME " [--mine MINE] [-l|--layer LAYER]... [-j|--jobs N] [-m|--move] restore <path>\n\n");
+		printf("Replaces the symlink at <path> (or every symlink inside of it) by a copy of what it points to in the mine\n");
+		printf("With --move, the files are taken out of the mine instead\n");
+		return;
+	}
+
+	const char *path = get_next("path");
+
+	size_t n = restore_path(path);
+	printf("restored %zu files\n", n);
+}
+
+enum LayerWalk show_entry(const struct LayerEntry *entry, void *data) {
+	(void)data;
+
+	printf("%*s%s%s%s", entry->depth > 0 ? entry->depth - 1 : 0, "", entry->depth > 0 ? "└" : "", entry->name, entry->is_dir ? "/" : "");
+	if (flags.layer_count > 1) {
+		if (__builtin_popcount(entry->merged) > 1) printf("  (merged)");
+		else printf("  (%s)", flags.layers[entry->layer]);
+	}
+	printf("\n");
+
+	return WALK_CONTINUE;
+}
+
 void command_show() {
 	if (flags.help) {
-		printf("usage: " NAME " [--mine MINE] show\n\n");
+		printf("usage: " NAME " [--mine MINE] [-l|--layer LAYER]... show\n\n");
+		printf("Shows the tree of files in the mine (and its layers)\n");
 		return;
 	}
+
+	walk_layers(flags.layers, flags.layer_count, show_entry, NULL);
 }
 
 int main(int argc, char **argv) {
@@ -73,6 +151,9 @@ int main(int argc, char **argv) {
 			} } while(0)
 
 		COMMAND(add);
+		COMMAND(stow);
+		COMMAND(relink);
+		COMMAND(restore);
 		COMMAND(show);
 
 		#undef COMMAND
@@ -89,11 +170,20 @@ int main(int argc, char **argv) {
 	printf("  -h, --help      Show this help, or help about the given subcommand\n");
 	printf("  -v, --version   Show the version\n");
 	printf("  -r, --recursive Don't symlink directories, always traverse them and symlink files\n");
+	printf("  -m, --move      Move files out of the mine instead of copying them when restoring\n");
 	printf("  --mine          Set location of dotmine folder (default: ~/dotmine)\n");
+	printf("  -j, --jobs      Number of threads used by parallel commands (default: one per processor)\n");
+	printf("  -l, --layer     Add a layer on top of the mine, shadowing it and the previous layers (can be repeated)\n");
 	printf("\n");
 	printf("subcommands:\n");
 	printf("    add <path> \n");
 	printf("        Adds a file or a directory to the mine\n");
+	printf("    stow\n");
+	printf("        Symlinks every file of the mine (and its layers) in the home directory\n");
+	printf("    relink <old> [new]\n");
+	printf("        Points every symlink to <old> (a previous location of the mine) to <new> (default: the mine)\n");
+	printf("    restore <path>\n");
+	printf("        Replaces symlinks to the mine by the files they point to (the inverse of add)\n");
 	printf("    show\n");
 	printf("        Show the tree of files in the mine and where they point to\n");
 
@@ -0,0 +1,53 @@
+#include "parallel.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct Worker {
+	atomic_size_t next;
+	size_t count;
+	ParallelTask task;
+	void *data;
+};
+
+static void *run_worker(void *arg) {
+	struct Worker *w = arg;
+	for (size_t i = atomic_fetch_add(&w->next, 1); i < w->count; i = atomic_fetch_add(&w->next, 1)) {
+		w->task(i, w->data);
+	}
+	return NULL;
+}
+
+void parallel_for(size_t count, int jobs, ParallelTask task, void *data) {
+	if (jobs <= 0) {
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = n > 0 ? n : 1;
+	}
+	if ((size_t)jobs > count) jobs = count;
+	if (jobs <= 1) {
+		for (size_t i = 0; i < count; i++) task(i, data);
+		return;
+	}
+
+	struct Worker w = { .count = count, .task = task, .data = data };
+	atomic_init(&w.next, 0);
+
+	pthread_t *threads = malloc((jobs - 1) * sizeof(pthread_t));
+	ASSERT(threads != NULL, "error: malloc failed with errno = %i", errno);
+
+	for (int i = 0; i < jobs - 1; i++) {
+		int result = pthread_create(&threads[i], NULL, run_worker, &w);
+		ASSERT(result == 0, "error: pthread_create failed with error = %i", result);
+	}
+	run_worker(&w);
+	for (int i = 0; i < jobs - 1; i++) {
+		int result = pthread_join(threads[i], NULL);
+		ASSERT(result == 0, "error: pthread_join failed with error = %i", result);
+	}
+
+	free(threads);
+}
@@ -0,0 +1,205 @@
+#define _GNU_SOURCE
+
+#include "path.h"
+
+#include <string.h>
+
+static size_t mismatch_scalar(const char *a, const char *b, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		if (a[i] != b[i]) return i;
+	}
+	return len;
+}
+
+#if !defined(NO_SIMD) && defined(__x86_64__)
+	#define PATH_SIMD
+	#include <immintrin.h>
+#endif
+
+// Separators are searched with glibc's memchr/memrchr, which are already vectorized
+// for every input length and beat hand written SSE2/AVX2 scans on path components.
+
+const char *path_find_sep(const char *s, size_t len) {
+	return memchr(s, '/', len);
+}
+
+const char *path_rfind_sep(const char *s, size_t len) {
+	return memrchr(s, '/', len);
+}
+
+#ifdef PATH_SIMD
+
+// Tails shorter than a vector are handled by one more load ending exactly at `len`, overlapping what was
+// already compared, and masking those bytes out. Nothing outside of the inputs is ever read,
+// so the versions below expect at least 16 bytes, shorter inputs go through the scalar loop.
+
+/// mask of the `n` lowest bits, `n` < 32
+static inline unsigned low_bits(size_t n) {
+	return (1u << n) - 1;
+}
+
+static size_t mismatch_sse2(const char *a, const char *b, size_t len) {
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) ^ 0xFFFF;
+		if (mask != 0) return i + __builtin_ctz(mask);
+	}
+	if (i < len) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + len - 16));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + len - 16));
+		unsigned mask = (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) ^ 0xFFFF) & ~low_bits(16 - (len - i));
+		if (mask != 0) return len - 16 + __builtin_ctz(mask);
+	}
+	return len;
+}
+
+// The AVX2 version handles its own tail with VEX encoded 128 bit instructions:
+// calling the SSE2 version with dirty upper registers would hit the SSE/AVX transition penalty.
+
+__attribute__((target("avx2")))
+static size_t mismatch_avx2(const char *a, const char *b, size_t len) {
+	size_t i = 0;
+	if (len >= 32) {
+		for (; i + 32 <= len; i += 32) {
+			__m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+			__m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+			unsigned mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+			if (mask != 0) {
+				_mm256_zeroupper();
+				return i + __builtin_ctz(mask);
+			}
+		}
+		_mm256_zeroupper();
+	}
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) ^ 0xFFFF;
+		if (mask != 0) return i + __builtin_ctz(mask);
+	}
+	if (i < len) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + len - 16));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + len - 16));
+		unsigned mask = (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) ^ 0xFFFF) & ~low_bits(16 - (len - i));
+		if (mask != 0) return len - 16 + __builtin_ctz(mask);
+	}
+	return len;
+}
+
+static size_t (*mismatch_impl)(const char *, const char *, size_t) = mismatch_sse2;
+
+__attribute__((constructor))
+static void select_impl() {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) mismatch_impl = mismatch_avx2;
+}
+
+// prefixes shorter than an AVX2 vector skip the indirect call
+size_t path_mismatch(const char *a, const char *b, size_t len) {
+	if (len < 16) return mismatch_scalar(a, b, len);
+	return len < 32 ? mismatch_sse2(a, b, len) : mismatch_impl(a, b, len);
+}
+
+#else
+
+size_t path_mismatch(const char *a, const char *b, size_t len) {
+	return mismatch_scalar(a, b, len);
+}
+
+#endif
+
+bool path_startswith(const char *s, size_t s_len, const char *prefix, size_t prefix_len) {
+	return s_len >= prefix_len && path_mismatch(s, prefix, prefix_len) == prefix_len;
+}
+
+/// returns the length of the normalized path, or -1 if the buffer wasn't big enough
+static long normalize(const char *pwd, size_t pwd_len, const char * src, size_t src_len, char *buf, size_t buf_len) {
+	char *res = buf;
+	size_t res_idx = 0;
+
+	const char * ptr = src;
+	const char * end = &src[src_len];
+	const char * next;
+
+	if (src_len == 0 || src[0] != '/') {
+		// relative path
+		size_t needed_len = pwd_len + 1 + src_len + 1;
+		if ( needed_len > buf_len) return -1;
+
+		memcpy(res, pwd, pwd_len);
+		res_idx = pwd_len;
+	} else {
+		size_t needed_len = (src_len > 0 ? src_len : 1) + 1;
+		if (needed_len > buf_len) return -1;
+
+		res_idx = 0;
+	}
+
+	// consecutive regular components are copied with a single memcpy, as the separators between them are single `/`s
+	const char *run = NULL;
+	const char *run_end = NULL;
+
+	for (ptr = src; ptr < end; ptr=next+1) {
+		size_t len;
+		next = path_find_sep(ptr, end-ptr);
+		if (next == NULL) {
+			next = end;
+		}
+		len = next-ptr;
+
+		bool special = len == 0 || (len == 1 && ptr[0] == '.') || (len == 2 && ptr[0] == '.' && ptr[1] == '.');
+		if (!special) {
+			if (run == NULL) run = ptr;
+			run_end = next;
+			continue;
+		}
+
+		if (run != NULL) {
+			res[res_idx++] = '/';
+			memcpy(&res[res_idx], run, run_end - run);
+			res_idx += run_end - run;
+			run = NULL;
+		}
+
+		if (len == 2) {
+			const char *slash = path_rfind_sep(res, res_idx);
+			if (slash != NULL) {
+				res_idx = slash - res;
+			}
+		}
+	}
+	if (run != NULL) {
+		res[res_idx++] = '/';
+		memcpy(&res[res_idx], run, run_end - run);
+		res_idx += run_end - run;
+	}
+
+	if (res_idx == 0) {
+		res[res_idx++] = '/';
+	}
+	res[res_idx] = '\0';
+	return res_idx;
+}
+
+int normalize_path(const char *pwd, size_t pwd_len, const char * src, size_t src_len, char *buf, size_t buf_len) {
+	return normalize(pwd, pwd_len, src, src_len, buf, buf_len) == -1 ? -1 : 0;
+}
+
+void normalize_links(struct LinkPath *links, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		struct LinkPath *l = &links[i];
+		l->len = normalize(l->dir, l->dir_len, l->value, l->value_len, l->buf, l->buf_len);
+	}
+}
+
+void links_in(const struct LinkPath *links, size_t count, const char *dir, size_t dir_len, bool *results) {
+	bool root = dir_len > 0 && dir[dir_len-1] == '/';
+	for (size_t i = 0; i < count; i++) {
+		const struct LinkPath *l = &links[i];
+		results[i] = l->len != -1 && path_startswith(l->buf, l->len, dir, dir_len)
+			&& ((size_t)l->len == dir_len || l->buf[dir_len] == '/' || root);
+	}
+}
@@ -4,23 +4,32 @@
 
 #include <ctype.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
-#include <libgen.h>
+#include <stdatomic.h>
 
 #include "flags.h"
 
 bool strstartswith(const char *s, const char *prefix) {
-	while (*s != '\0' && *prefix != '\0') {
-		if (*s != *prefix) return false;
+	size_t prefix_len = strlen(prefix);
+	return path_startswith(s, strnlen(s, prefix_len), prefix, prefix_len);
+}
+
+bool path_in(const char *path, const char *dir, size_t dir_len) {
+	return path_startswith(path, strnlen(path, dir_len), dir, dir_len)
+		&& (path[dir_len] == '\0' || path[dir_len] == '/' || dir[dir_len-1] == '/');
+}
 
-		s++;
-		prefix++;
+bool in_layers(const char *path) {
+	for (int i = 0; i < flags.layer_count; i++) {
+		if (path_in(path, flags.layers[i], strlen(flags.layers[i]))) return true;
 	}
-	return *prefix == '\0';
+	return false;
 }
 
 void get_link_path(const char *link, char *buf, ssize_t bufsize) {
@@ -32,13 +41,22 @@ void get_link_path(const char *link, char *buf, ssize_t bufsize) {
 	ASSERT(n > 0, "error: empty link");
 	link_value[n] = '\0';
 
-	char *link_dir = strdup(link);
-	link_dir = dirname(link_dir);
-	
-	int result = normalize_path(link_dir, strlen(link_dir), link_value, strlen(link_value), buf, bufsize);
-	ASSERT(result == 0, "error: not enough space reserved for link");
+	// same as `dirname`, without copying `link`
+	size_t link_len = strlen(link);
+	while (link_len > 1 && link[link_len-1] == '/') link_len--;
+
+	const char *link_dir = ".";
+	size_t dir_len = 1;
+	const char *slash = path_rfind_sep(link, link_len);
+	if (slash != NULL) {
+		link_dir = link;
+		dir_len = slash - link;
+		while (dir_len > 0 && link[dir_len-1] == '/') dir_len--;
+		if (dir_len == 0) dir_len = 1; // root
+	}
 
-	free(link_dir);
+	int result = normalize_path(link_dir, dir_len, link_value, n, buf, bufsize);
+	ASSERT(result == 0, "error: not enough space reserved for link");
 }
 
 char *get_target_path(const char *path) {
@@ -81,6 +99,40 @@ void create_symlink(const char *target, const char *link_name) {
 	if (free_link) free((void *)link_name);
 }
 
+int replace_symlinkat(const char *target, int dir_fd, const char *name) {
+	static atomic_uint counter;
+
+	// fixed length, so that links with long names don't end up with a temporary name over NAME_MAX
+	char tmp[64];
+	snprintf(tmp, 64, "." NAME "-%i-%u", getpid(), atomic_fetch_add(&counter, 1));
+
+	if (symlinkat(target, dir_fd, tmp) != 0) return -1;
+	if (renameat(dir_fd, tmp, dir_fd, name) != 0) {
+		int rename_errno = errno;
+		unlinkat(dir_fd, tmp, 0);
+		errno = rename_errno;
+		return -1;
+	}
+	return 0;
+}
+
+int replace_symlink(const char *target, const char *link_name) {
+	const char *slash = strrchr(link_name, '/');
+
+	char dir[PATH_MAX] = ".";
+	if (slash == link_name) strcpy(dir, "/");
+	else if (slash != NULL) snprintf(dir, PATH_MAX, "%.*s", (int)(slash - link_name), link_name);
+
+	int dir_fd = open(dir, O_PATH | O_DIRECTORY | O_CLOEXEC);
+	if (dir_fd == -1) return -1;
+
+	int result = replace_symlinkat(target, dir_fd, slash == NULL ? link_name : slash + 1);
+	int replace_errno = errno;
+	close(dir_fd);
+	errno = replace_errno;
+	return result;
+}
+
 char prompt_user(const char *prompt, const char *choices, char default_value) {
 	char *indicator = malloc(strlen(choices)*2);
 	char *writer = indicator;
@@ -186,62 +238,153 @@ void create_structure(char *path) {
 	}
 }
 
-int normalize_path(const char *pwd, size_t pwd_len, const char * src, size_t src_len, char *buf, size_t buf_len) {
-	char *res = buf;
-	size_t res_idx = 0;
+/// state of a `find_links` call
+/// number of symlinks normalized and compared together
+#define LINK_BATCH 64
+/// room taken by a symlink in `LinkSearch.arena`: its name, its value and its normalized path
+#define LINK_ROOM (NAME_MAX + 1 + 2*PATH_MAX)
+
+struct LinkSearch {
+	const char *skip;
+	size_t skip_len;
+	const char *const *targets;
+	size_t target_lens[MAX_LAYERS];
+	int target_count;
+	size_t layer_lens[MAX_LAYERS];
+	LinkVisitor visit;
+	void *data;
+
+	/// symlinks of the current directory, normalized and compared together before being visited
+	struct LinkPath links[LINK_BATCH];
+	/// offset of the name of each symlink in `arena`
+	size_t names[LINK_BATCH];
+	size_t count;
+	/// holds the names, values and normalized paths of the symlinks, big enough for a whole batch
+	char arena[LINK_BATCH * LINK_ROOM];
+	size_t arena_len;
+};
+
+static void flush_links(struct LinkSearch *ls, char *path, size_t path_len) {
+	normalize_links(ls->links, ls->count);
+
+	bool inside[LINK_BATCH] = { 0 };
+	for (int t = 0; t < ls->target_count; t++) {
+		bool in_target[LINK_BATCH];
+		links_in(ls->links, ls->count, ls->targets[t], ls->target_lens[t], in_target);
+		for (size_t i = 0; i < ls->count; i++) inside[i] |= in_target[i];
+	}
 
-	const char * ptr = src;
-	const char * end = &src[src_len];
-	const char * next;
+	for (size_t i = 0; i < ls->count; i++) {
+		if (!inside[i]) continue;
 
-	if (src_len == 0 || src[0] != '/') {
-		// relative path
-		size_t needed_len = pwd_len + 1 + src_len + 1;
-		if ( needed_len > buf_len) return -1;
+		snprintf(path + path_len, PATH_MAX - path_len, "/%s", ls->arena + ls->names[i]); // length already checked
+		ls->visit(path, ls->links[i].buf, ls->data);
+	}
+	path[path_len] = '\0';
 
-		memcpy(res, pwd, pwd_len);
-		res_idx = pwd_len;
-	} else {
-		size_t needed_len = (src_len > 0 ? src_len : 1) + 1;
-		if (needed_len > buf_len) return -1;
+	ls->count = 0;
+	ls->arena_len = 0;
+}
 
-		res_idx = 0;
-	}
+/// `path` is a buffer of PATH_MAX bytes, and `fd` is consumed by this function
+/// the batch of `ls` is empty when called and when returning
+static void find_links_in(int fd, char *path, size_t path_len, struct LinkSearch *ls) {
+	DIR *dp = fdopendir(fd);
+	ASSERT(dp != NULL, "error: fdopendir failed with errno = %i", errno);
+
+	errno = 0;
+	struct dirent *ep;
+	while ((ep = readdir(dp)) != NULL) {
+		if (strcmp(ep->d_name, ".") == 0 || strcmp(ep->d_name, "..") == 0) { // avoid self recursion
+			continue;
+		}
 
-	for (ptr = src; ptr < end; ptr=next+1) {
-		size_t len;
-		next = memchr(ptr, '/', end-ptr);
-		if (next == NULL) {
-			next = end;
+		size_t n = snprintf(path + path_len, PATH_MAX - path_len, "/%s", ep->d_name);
+		if (path_len + n >= PATH_MAX) {
+			path[path_len] = '\0';
+			LOG("warning: path `%s/%s` is too long, skipping", path, ep->d_name);
+			errno = 0;
+			continue;
 		}
-		len = next-ptr;
-		switch(len) {
-			case 2:
-				if (ptr[0] == '.' && ptr[1] == '.') {
-					const char *slash = memrchr(res, '/', res_idx);
-					if (slash != NULL) {
-						res_idx = slash - res;
-					}
-					continue;
-				}
-				break;
-			case 1:
-				if (ptr[0] == '.') {
-					continue;
-
-				}
-				break;
-			case 0:
-				continue;
+
+		unsigned char type = ep->d_type;
+		if (type == DT_UNKNOWN) { // filesystem doesn't fill d_type
+			struct stat sd = { 0 };
+			ASSERT(fstatat(fd, ep->d_name, &sd, AT_SYMLINK_NOFOLLOW) == 0, "error: stat failed with errno = %i", errno);
+			type = S_ISDIR(sd.st_mode) ? DT_DIR : S_ISLNK(sd.st_mode) ? DT_LNK : DT_REG;
+		}
+
+		if (type == DT_DIR) {
+			bool skipped = ls->skip != NULL && path_in(path, ls->skip, ls->skip_len);
+			for (int i = 0; i < flags.layer_count && !skipped; i++) {
+				skipped = path_in(path, flags.layers[i], ls->layer_lens[i]);
+			}
+
+			int child = skipped ? -1 : openat(fd, ep->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+			if (child != -1) {
+				flush_links(ls, path, path_len); // the batch only holds symlinks of the current directory
+				snprintf(path + path_len, PATH_MAX - path_len, "/%s", ep->d_name);
+				find_links_in(child, path, path_len + n, ls);
+			} else if (!skipped) {
+				LOG("warning: could not open `%s` (errno = %i), skipping", path, errno);
+			}
+		} else if (type == DT_LNK) {
+			if (ls->count == LINK_BATCH) {
+				path[path_len] = '\0';
+				flush_links(ls, path, path_len);
+			}
+
+			size_t name = ls->arena_len;
+			size_t name_len = strlen(ep->d_name) + 1;
+			memcpy(ls->arena + name, ep->d_name, name_len);
+
+			char *value = ls->arena + name + name_len;
+			ssize_t len = readlinkat(fd, ep->d_name, value, PATH_MAX);
+			ASSERT(len != -1, "error: readlink failed with errno = %i", errno);
+
+			if (len < PATH_MAX) {
+				ls->names[ls->count] = name;
+				ls->links[ls->count++] = (struct LinkPath){
+					.dir = path, .dir_len = path_len,
+					.value = value, .value_len = len,
+					.buf = value + len, .buf_len = PATH_MAX
+				};
+				ls->arena_len = name + name_len + len + PATH_MAX;
+			}
 		}
-		res[res_idx++] = '/';
-		memcpy(&res[res_idx], ptr, len);
-		res_idx += len;
-	}
 
-	if (res_idx == 0) {
-		res[res_idx++] = '/';
+		path[path_len] = '\0';
+		errno = 0;
 	}
-	res[res_idx] = '\0';
-	return 0;
+	ASSERT(errno == 0, "error: readdir failed with errno = %i", errno);
+	flush_links(ls, path, path_len);
+	ASSERT(closedir(dp) == 0, "error: closedir failed with errno = %i", errno);
+}
+
+void find_links(const char *dir, const char *skip, const char *const *targets, int target_count, LinkVisitor visit, void *data) {
+	ASSERT(target_count <= MAX_LAYERS, "error: too many targets passed to %s", __FUNCTION__);
+
+	char path[PATH_MAX];
+	int n = snprintf(path, PATH_MAX, "%s", dir);
+	ASSERT(n < PATH_MAX, "error: not enough space allocated for path");
+	while (n > 1 && path[n-1] == '/') path[--n] = '\0';
+
+	int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	ASSERT(fd != -1, "error: open failed with errno = %i", errno);
+
+	struct LinkSearch *ls = malloc(sizeof(struct LinkSearch));
+	ASSERT(ls != NULL, "error: malloc failed with errno = %i", errno);
+	ls->skip = skip;
+	ls->skip_len = skip != NULL ? strlen(skip) : 0;
+	ls->targets = targets;
+	ls->target_count = target_count;
+	for (int i = 0; i < target_count; i++) ls->target_lens[i] = strlen(targets[i]);
+	for (int i = 0; i < flags.layer_count; i++) ls->layer_lens[i] = strlen(flags.layers[i]);
+	ls->visit = visit;
+	ls->data = data;
+	ls->count = 0;
+	ls->arena_len = 0;
+
+	find_links_in(fd, path, n, ls);
+	free(ls);
 }
@@ -0,0 +1,190 @@
+// Fuzzes the path primitives against the scalar implementations they replaced, and fails on the first difference.
+// Inputs and output buffers are often placed right before an unmapped page, so reading or writing past them crashes.
+// usage: path_fuzz [iterations] [seed]
+
+#define _GNU_SOURCE
+
+#include "path.h"
+#include "path_reference.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static uint64_t rng_state;
+
+static uint64_t rng() {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+/// writes a random path made of components like `..`, `.`, `//` and names of random length
+static size_t random_path(char *buf, size_t max_len, bool absolute) {
+	static const char *pieces[] = { "..", ".", "", "a", "config", "nvim", "dotmine", "very_long_directory_name_for_simd_lanes" };
+	size_t len = 0;
+	if (absolute) buf[len++] = '/';
+
+	int components = rng() % 12;
+	for (int i = 0; i < components; i++) {
+		const char *piece = pieces[rng() % (sizeof(pieces) / sizeof(*pieces))];
+		size_t piece_len = strlen(piece);
+		if (len + piece_len + 1 >= max_len) break;
+
+		memcpy(buf + len, piece, piece_len);
+		len += piece_len;
+		if (i + 1 < components || rng() % 4 == 0) buf[len++] = '/';
+	}
+	buf[len] = '\0';
+	return len;
+}
+
+/// writes random bytes with a few `/`, so that vector loops reach their tails
+static size_t random_bytes(char *buf, size_t max_len) {
+	size_t len = rng() % max_len;
+	for (size_t i = 0; i < len; i++) {
+		buf[i] = rng() % 48 == 0 ? '/' : 'a' + rng() % 26;
+	}
+	buf[len] = '\0';
+	return len;
+}
+
+#define BATCH 8
+#define GUARDS (3*BATCH + 2)
+
+static size_t page_size;
+/// pages followed by an unmapped page
+static char *guards[GUARDS];
+
+static void map_guards() {
+	page_size = sysconf(_SC_PAGESIZE);
+	for (int i = 0; i < GUARDS; i++) {
+		char *p = mmap(NULL, 2*page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED || mprotect(p + page_size, page_size, PROT_NONE) != 0) {
+			fprintf(stderr, "error: failed to map guard pages with errno = %i\n", errno);
+			exit(1);
+		}
+		guards[i] = p;
+	}
+}
+
+/// returns `len` bytes ending right before the unmapped page of guard `i`, half of the time.
+/// the other half, returns `fallback`, which holds at least `len` bytes.
+static char *place(int i, char *fallback, size_t len) {
+	return rng() % 2 ? guards[i] + page_size - len : fallback;
+}
+
+/// copies `len` bytes of `s` to the end of guard `i`, half of the time
+static const char *flush(int i, const char *s, size_t len) {
+	char *p = place(i, (char *)s, len);
+	if (p != s) memmove(p, s, len);
+	return p;
+}
+
+static void fail(const char *what, const char *a, const char *b) {
+	fprintf(stderr, "%s differs from the reference implementation on \"%s\", \"%s\"\n", what, a, b);
+	exit(1);
+}
+
+/// primitives scanning a single path
+static void fuzz_primitives() {
+	char pwd[512], src[512], other[512];
+	size_t pwd_len = rng() % 2 ? random_path(pwd, sizeof(pwd), true) : random_bytes(pwd, 128);
+	size_t src_len = rng() % 2 ? random_path(src, sizeof(src), rng() % 2) : random_bytes(src, 128);
+
+	const char *s = flush(0, src, src_len);
+	if (path_find_sep(s, src_len) != memchr(s, '/', src_len)) fail("path_find_sep", src, "");
+	if (path_rfind_sep(s, src_len) != memrchr(s, '/', src_len)) fail("path_rfind_sep", src, "");
+
+	// a prefix of pwd, sometimes with one byte changed
+	size_t cut = rng() % (pwd_len + 1);
+	memcpy(other, pwd, cut);
+	other[cut] = '\0';
+	if (rng() % 2 == 0 && cut > 0) other[rng() % cut] ^= 1;
+
+	bool swap = rng() % 2;
+	const char *str = swap ? other : pwd;
+	const char *prefix = swap ? pwd : other;
+	size_t str_len = strlen(str), prefix_len = strlen(prefix);
+	bool expected = reference_strstartswith(str, prefix);
+
+	const char *a = flush(0, str, str_len);
+	const char *b = flush(1, prefix, prefix_len);
+	if (path_startswith(a, str_len, b, prefix_len) != expected) fail("path_startswith", str, prefix);
+
+	size_t len = str_len < prefix_len ? str_len : prefix_len;
+	size_t expected_mismatch = 0;
+	while (expected_mismatch < len && str[expected_mismatch] == prefix[expected_mismatch]) expected_mismatch++;
+	a = flush(0, str, len);
+	b = flush(1, prefix, len);
+	if (path_mismatch(a, b, len) != expected_mismatch) fail("path_mismatch", str, prefix);
+}
+
+/// `normalize_links` and `links_in`, checked per element
+static void fuzz_batch() {
+	static char dirs[BATCH][512], values[BATCH][512], bufs[BATCH][1024];
+	char expected[BATCH][1024];
+	int expected_results[BATCH];
+	struct LinkPath links[BATCH];
+
+	size_t count = rng() % (BATCH + 1);
+	for (size_t i = 0; i < count; i++) {
+		size_t dir_len = random_path(dirs[i], sizeof(dirs[i]), true);
+		size_t value_len = random_path(values[i], sizeof(values[i]), rng() % 2);
+		size_t buf_len = rng() % 4 == 0 ? rng() % 64 : sizeof(bufs[i]);
+
+		expected_results[i] = reference_normalize_path(dirs[i], dir_len, values[i], value_len, expected[i], buf_len);
+		links[i] = (struct LinkPath){
+			.dir = flush(2 + 3*i, dirs[i], dir_len), .dir_len = dir_len,
+			.value = flush(3 + 3*i, values[i], value_len), .value_len = value_len,
+			.buf = place(4 + 3*i, bufs[i], buf_len), .buf_len = buf_len
+		};
+	}
+
+	normalize_links(links, count);
+	for (size_t i = 0; i < count; i++) {
+		bool ok = expected_results[i] == -1
+			? links[i].len == -1
+			: links[i].len == (long)strlen(expected[i]) && strcmp(links[i].buf, expected[i]) == 0;
+		if (!ok) fail("normalize_links", dirs[i], values[i]);
+	}
+
+	// a prefix of one of the results, cut anywhere, or an unrelated path
+	char dir[512];
+	size_t dir_len;
+	size_t from = count > 0 ? rng() % count : 0;
+	if (count > 0 && expected_results[from] == 0 && strlen(expected[from]) < sizeof(dir) && rng() % 4 != 0) {
+		dir_len = rng() % (strlen(expected[from]) + 1);
+		memcpy(dir, expected[from], dir_len);
+		if (rng() % 4 == 0 && dir_len < sizeof(dir) - 1) dir[dir_len++] = '/';
+		dir[dir_len] = '\0';
+	} else {
+		dir_len = random_path(dir, sizeof(dir), true);
+	}
+
+	bool results[BATCH];
+	links_in(links, count, flush(0, dir, dir_len), dir_len, results);
+	for (size_t i = 0; i < count; i++) {
+		bool expected_in = expected_results[i] == 0 && reference_path_in(expected[i], dir);
+		if (results[i] != expected_in) fail("links_in", expected_results[i] == 0 ? expected[i] : values[i], dir);
+	}
+}
+
+int main(int argc, char **argv) {
+	long iterations = argc > 1 ? atol(argv[1]) : 200000;
+	rng_state = argc > 2 ? strtoull(argv[2], NULL, 10) : 0x9E3779B97F4A7C15ull;
+	if (rng_state == 0) rng_state = 1;
+
+	map_guards();
+	for (long i = 0; i < iterations; i++) {
+		fuzz_primitives();
+		fuzz_batch();
+	}
+	printf("fuzz: %li cases matched the reference implementation\n", iterations);
+	return 0;
+}
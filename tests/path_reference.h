@@ -0,0 +1,82 @@
+#pragma once
+
+/// Scalar implementations the path primitives replaced, shared by the fuzz test and the benchmark.
+
+#include <stdbool.h>
+#include <string.h>
+
+static int reference_normalize_path(const char *pwd, size_t pwd_len, const char * src, size_t src_len, char *buf, size_t buf_len) {
+	char *res = buf;
+	size_t res_idx = 0;
+
+	const char * ptr = src;
+	const char * end = &src[src_len];
+	const char * next;
+
+	if (src_len == 0 || src[0] != '/') {
+		size_t needed_len = pwd_len + 1 + src_len + 1;
+		if ( needed_len > buf_len) return -1;
+
+		memcpy(res, pwd, pwd_len);
+		res_idx = pwd_len;
+	} else {
+		size_t needed_len = (src_len > 0 ? src_len : 1) + 1;
+		if (needed_len > buf_len) return -1;
+
+		res_idx = 0;
+	}
+
+	for (ptr = src; ptr < end; ptr=next+1) {
+		size_t len;
+		next = memchr(ptr, '/', end-ptr);
+		if (next == NULL) {
+			next = end;
+		}
+		len = next-ptr;
+		switch(len) {
+			case 2:
+				if (ptr[0] == '.' && ptr[1] == '.') {
+					const char *slash = memrchr(res, '/', res_idx);
+					if (slash != NULL) {
+						res_idx = slash - res;
+					}
+					continue;
+				}
+				break;
+			case 1:
+				if (ptr[0] == '.') {
+					continue;
+				}
+				break;
+			case 0:
+				continue;
+		}
+		res[res_idx++] = '/';
+		memcpy(&res[res_idx], ptr, len);
+		res_idx += len;
+	}
+
+	if (res_idx == 0) {
+		res[res_idx++] = '/';
+	}
+	res[res_idx] = '\0';
+	return 0;
+}
+
+static bool reference_strstartswith(const char *s, const char *prefix) {
+	while (*s != '\0' && *prefix != '\0') {
+		if (*s != *prefix) return false;
+
+		s++;
+		prefix++;
+	}
+	return *prefix == '\0';
+}
+
+/// true if `path` is `dir` or is inside of it, `dir` may end with a `/`
+static bool reference_path_in(const char *path, const char *dir) {
+	size_t dir_len = strlen(dir);
+	if (!reference_strstartswith(path, dir)) return false;
+
+	return dir_len == 0 || path[dir_len] == '\0' || path[dir_len] == '/' || dir[dir_len-1] == '/';
+}